@@ -1,6 +1,16 @@
+#define _DEFAULT_SOURCE
 #include "allocator.h"
+#include "trace.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define VIRTUAL_ALIGNMENT 16
+#define VIRTUAL_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+static size_t round_up(size_t value, size_t multiple);
+static int virtual_commit(VirtualAllocator *va, size_t new_end);
 
 StackAllocator new_stack_allocator(void *arena, unsigned int arena_size) {
   StackAllocator a = {};
@@ -9,15 +19,16 @@ StackAllocator new_stack_allocator(void *arena, unsigned int arena_size) {
   return a;
 }
 
-void *stack_alloc(struct Allocator *allocator, unsigned int sz_bytes) {
+void *stack_alloc(struct Allocator *allocator, size_t sz_bytes) {
+  TRACE_ZONE("stack_alloc");
   StackAllocator *sa = (StackAllocator *)allocator->strategy;
-  printf("reserving %u bytes space\n", sz_bytes);
   if (sa->end + sz_bytes > sa->max_size) {
     printf("stack allocator overflow detected, aborting...");
     exit(1);
   }
   const unsigned int begin = sa->end;
   sa->end += sz_bytes;
+  TRACE_COUNTER("stack_alloc.bytes", sa, sa->end);
   return sa->arena + begin;
 }
 
@@ -26,13 +37,167 @@ void stack_free(struct Allocator *allocator) {
   sa->end = 0;
 }
 
-void *heap_alloc(struct Allocator *allocator, unsigned int sz_bytes) {
+void *heap_alloc(struct Allocator *allocator, size_t sz_bytes) {
+  TRACE_ZONE("heap_alloc");
   return malloc(sz_bytes);
 }
 
-void heap_free(struct Allocator *allocator, void *address) { free(address); }
+void heap_free(struct Allocator *allocator, void *address) {
+  TRACE_ZONE("heap_free");
+  free(address);
+}
 
 void *heap_realloc(struct Allocator *allocator, void *address,
-                   unsigned int sz_bytes) {
+                   size_t sz_bytes) {
+  TRACE_ZONE("heap_realloc");
   return realloc(address, sz_bytes);
 }
+
+VirtualAllocator new_virtual_allocator(size_t reserve_bytes, int flags) {
+  VirtualAllocator va = {};
+  va.flags = flags;
+  va.granularity = (size_t)sysconf(_SC_PAGESIZE);
+#ifdef MADV_HUGEPAGE
+  if (flags & VIRTUAL_HUGE_PAGES) {
+    va.granularity = VIRTUAL_HUGE_PAGE_SIZE;
+  }
+#endif
+  va.reserved = round_up(reserve_bytes, va.granularity);
+
+  // Over-reserve by one granule so the range can be aligned to it, otherwise
+  // the kernel is unable to back it with huge pages.
+  size_t mapped = va.reserved + va.granularity;
+  int mmap_flags = MAP_PRIVATE | MAP_ANON;
+#ifdef MAP_NORESERVE
+  mmap_flags |= MAP_NORESERVE;
+#endif
+  char *region = mmap(NULL, mapped, PROT_NONE, mmap_flags, -1, 0);
+  if (region == MAP_FAILED) {
+    va.reserved = 0;
+    return va;
+  }
+  char *base = (char *)round_up((size_t)region, va.granularity);
+  if (base > region) {
+    munmap(region, base - region);
+  }
+  munmap(base + va.reserved, (region + mapped) - (base + va.reserved));
+  va.base = base;
+
+#ifdef MADV_HUGEPAGE
+  if (flags & VIRTUAL_HUGE_PAGES) {
+    madvise(va.base, va.reserved, MADV_HUGEPAGE);
+  }
+#endif
+  return va;
+}
+
+Allocator virtual_allocator_interface(VirtualAllocator *va) {
+  Allocator allocator = {
+      .strategy = va,
+      .alloc = virtual_alloc,
+      .realloc = virtual_realloc,
+      .free = virtual_free,
+      .free_all = virtual_free_all,
+  };
+  return allocator;
+}
+
+void *virtual_alloc(struct Allocator *allocator, size_t sz_bytes) {
+  TRACE_ZONE("virtual_alloc");
+  VirtualAllocator *va = (VirtualAllocator *)allocator->strategy;
+  if (va->base == NULL) {
+    return NULL;
+  }
+  size_t begin = round_up(va->end, VIRTUAL_ALIGNMENT);
+  if (begin > va->reserved || sz_bytes > va->reserved - begin) {
+    return NULL;
+  }
+  if (!virtual_commit(va, begin + sz_bytes)) {
+    return NULL;
+  }
+  va->last = begin;
+  va->end = begin + sz_bytes;
+  return va->base + begin;
+}
+
+void *virtual_realloc(struct Allocator *allocator, void *address,
+                      size_t sz_bytes) {
+  TRACE_ZONE("virtual_realloc");
+  VirtualAllocator *va = (VirtualAllocator *)allocator->strategy;
+  if (address == NULL) {
+    return virtual_alloc(allocator, sz_bytes);
+  }
+
+  // Only the most recent allocation is able to grow or shrink in place.
+  // Anything older would have to be copied, which this allocator never does.
+  size_t begin = (char *)address - va->base;
+  if (begin != va->last) {
+    return NULL;
+  }
+  if (sz_bytes > va->reserved - begin) {
+    return NULL;
+  }
+  if (!virtual_commit(va, begin + sz_bytes)) {
+    return NULL;
+  }
+  va->end = begin + sz_bytes;
+  return address;
+}
+
+void virtual_free(struct Allocator *allocator, void *address) {
+  VirtualAllocator *va = (VirtualAllocator *)allocator->strategy;
+  // Only the most recent allocation can be handed back, everything else is
+  // reclaimed by `virtual_free_all`.
+  if (address != NULL && (char *)address - va->base == va->last) {
+    va->end = va->last;
+  }
+}
+
+void virtual_free_all(struct Allocator *allocator) {
+  TRACE_ZONE("virtual_free_all");
+  VirtualAllocator *va = (VirtualAllocator *)allocator->strategy;
+  if (va->committed > 0) {
+    // Drop the physical pages and decommit the range, the address space
+    // itself stays reserved.
+    madvise(va->base, va->committed, MADV_DONTNEED);
+    mprotect(va->base, va->committed, PROT_NONE);
+  }
+  va->committed = 0;
+  va->end = 0;
+  va->last = 0;
+  TRACE_COUNTER("virtual.committed_bytes", va, 0);
+}
+
+void virtual_release(VirtualAllocator *va) {
+  if (va->base != NULL) {
+    munmap(va->base, va->reserved);
+  }
+  va->base = NULL;
+  va->reserved = 0;
+  va->committed = 0;
+  va->end = 0;
+  va->last = 0;
+}
+
+// Makes sure all bytes up to `new_end` are readable and writable. Returns 0 if
+// the pages could not be committed.
+static int virtual_commit(VirtualAllocator *va, size_t new_end) {
+  if (new_end <= va->committed) {
+    return 1;
+  }
+  size_t commit_end = round_up(new_end, va->granularity);
+  if (commit_end > va->reserved) {
+    commit_end = va->reserved;
+  }
+  if (mprotect(va->base + va->committed, commit_end - va->committed,
+               PROT_READ | PROT_WRITE) != 0) {
+    return 0;
+  }
+  va->committed = commit_end;
+  TRACE_COUNTER("virtual.committed_bytes", va, va->committed);
+  return 1;
+}
+
+static size_t round_up(size_t value, size_t multiple) {
+  return (value + multiple - 1) / multiple * multiple;
+}
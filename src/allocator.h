@@ -1,16 +1,18 @@
 #ifndef ALLOCATOR_H
 #define ALLOCATOR_H
 
+#include <stddef.h>
+
 // Handles requests for memory allocations and frees.
 typedef struct Allocator {
   // The implementation for this allocator.
   void *strategy;
   // Allocates a contiguous array of the given size in bytes.
-  void *(*alloc)(struct Allocator *allocator, unsigned int sz_bytes);
+  void *(*alloc)(struct Allocator *allocator, size_t sz_bytes);
   // Reallocates the data at the given pointer reserving the given amount of
   // bytes.
   void *(*realloc)(struct Allocator *allocator, void *address,
-                   unsigned int sz_bytes);
+                   size_t sz_bytes);
   // Free reserved memory at the given address.
   void (*free)(struct Allocator *allocator, void *address);
   // Frees all reserved/used memory managed by this allocator.
@@ -29,15 +31,52 @@ typedef struct StackAllocator {
 } StackAllocator;
 
 StackAllocator new_stack_allocator(void *arena, unsigned int arena_size);
-void *stack_alloc(struct Allocator *allocator, unsigned int sz_bytes);
+void *stack_alloc(struct Allocator *allocator, size_t sz_bytes);
 void stack_free(struct Allocator *allocator);
 
 typedef struct HeapAllocator {
 } HeapAllocator;
 
-void *heap_alloc(struct Allocator *allocator, unsigned int sz_bytes);
+void *heap_alloc(struct Allocator *allocator, size_t sz_bytes);
 void *heap_realloc(struct Allocator *allocator, void *address,
-                   unsigned int sz_bytes);
+                   size_t sz_bytes);
 void heap_free(struct Allocator *allocator, void *address);
 
+// Back the reservation with transparent huge pages where the OS supports it.
+#define VIRTUAL_HUGE_PAGES 0x1
+
+// Reserves a large range of address space up front and commits pages on
+// demand. The most recent allocation grows in place, so pointers into it stay
+// valid across `realloc` and no copy is ever made. Reallocating any older
+// allocation fails and returns NULL, so a vector which should grow needs an
+// allocator of its own.
+typedef struct VirtualAllocator {
+  // Start of the reserved address range, NULL if the reservation failed.
+  char *base;
+  // Size of the reserved address range in bytes.
+  size_t reserved;
+  // Number of bytes starting at `base` which are readable and writable.
+  size_t committed;
+  // Offset of the first free byte.
+  size_t end;
+  // Offset of the most recent allocation, the only one able to grow in place.
+  size_t last;
+  // Pages are committed in multiples of this many bytes.
+  size_t granularity;
+  int flags;
+} VirtualAllocator;
+
+VirtualAllocator new_virtual_allocator(size_t reserve_bytes, int flags);
+// Returns an `Allocator` dispatching to the given virtual allocator, which has
+// to outlive it.
+Allocator virtual_allocator_interface(VirtualAllocator *va);
+void *virtual_alloc(struct Allocator *allocator, size_t sz_bytes);
+void *virtual_realloc(struct Allocator *allocator, void *address,
+                      size_t sz_bytes);
+void virtual_free(struct Allocator *allocator, void *address);
+void virtual_free_all(struct Allocator *allocator);
+// Returns the reserved address range to the OS. The allocator is unusable
+// afterwards.
+void virtual_release(VirtualAllocator *va);
+
 #endif // ALLOCATOR_H
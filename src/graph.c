@@ -1,5 +1,6 @@
 #include "graph.h"
 #include "allocator.h"
+#include "trace.h"
 
 static HeapAllocator default_allocator = {};
 static Allocator allocator = {
@@ -53,6 +54,7 @@ Node **new_neighbors(const Node **neighbors, int num_of_neighbors) {
 //    This has the downside, that heap allocation will be done, where there is
 //    no heap allocation necessary.
 GraphError new_node(Node **neighbors, int num_of_neighbors, Node *node_result) {
+  TRACE_ZONE("new_node");
   if (node_result == NULL) {
     return GRAPH_INVALID_MEMORY_RESULT;
   }
@@ -89,6 +91,7 @@ void print_node(const Node *node) {
 }
 
 static GraphError add_node_to(Node *neighbor, Node *added_node) {
+  TRACE_ZONE("add_node_to");
   // Allocate a new array which allows to store all neighbors.
   Node **new_neighbors = allocator.alloc(
       &allocator, (neighbor->num_of_neighbors + 1) * sizeof(Node));
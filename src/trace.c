@@ -0,0 +1,185 @@
+#define _DEFAULT_SOURCE
+#include "trace.h"
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef TRACE_ENABLED
+
+typedef enum {
+  TRACE_EVENT_ZONE,
+  TRACE_EVENT_COUNTER,
+} TraceEventType;
+
+typedef struct TraceEvent {
+  const char *name;
+  uint64_t timestamp;
+  // End of a zone in ticks or the value of a counter.
+  uint64_t value;
+  // Instance a counter belongs to, NULL for a single global track.
+  const void *id;
+  TraceEventType type;
+} TraceEvent;
+
+typedef struct TraceBuffer {
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+  // Number of events ever written. Only the owning thread writes it, the
+  // exporter reads it.
+  uint64_t head;
+  unsigned int thread_id;
+  struct TraceBuffer *next;
+} TraceBuffer;
+
+// All thread buffers ever registered. Buffers outlive their threads so their
+// events can still be exported.
+static TraceBuffer *buffers = NULL;
+static unsigned int next_thread_id = 0;
+static __thread TraceBuffer *thread_buffer = NULL;
+
+static TraceBuffer *trace_register_thread(void);
+static uint64_t trace_first_timestamp(void);
+static void trace_record(TraceEvent event);
+static double ns_per_tick(void);
+
+void trace_zone_end(TraceZone *zone) {
+  TraceEvent event = {
+      .name = zone->name,
+      .timestamp = zone->begin,
+      .value = trace_now(),
+      .type = TRACE_EVENT_ZONE,
+  };
+  trace_record(event);
+}
+
+void trace_counter(const char *name, const void *id, uint64_t value) {
+  TraceEvent event = {
+      .name = name,
+      .timestamp = trace_now(),
+      .value = value,
+      .id = id,
+      .type = TRACE_EVENT_COUNTER,
+  };
+  trace_record(event);
+}
+
+TraceError trace_export_chrome(FILE *out) {
+  double scale = ns_per_tick() / 1000.0;
+  uint64_t start = trace_first_timestamp();
+  const char *separator = "";
+
+  fprintf(out, "{\"traceEvents\":[");
+  for (TraceBuffer *buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+       buffer != NULL; buffer = buffer->next) {
+    uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint64_t first =
+        head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+    for (uint64_t o = first; o < head; ++o) {
+      TraceEvent *event = &buffer->events[o % TRACE_BUFFER_EVENTS];
+      double ts = (double)(event->timestamp - start) * scale;
+      if (event->type == TRACE_EVENT_ZONE) {
+        fprintf(out,
+                "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"dur\":%.3f}",
+                separator, event->name, buffer->thread_id, ts,
+                (double)(event->value - event->timestamp) * scale);
+      } else {
+        fprintf(out,
+                "%s\n{\"name\":\"%s\",\"ph\":\"C\",\"pid\":1,\"tid\":%u,"
+                "\"ts\":%.3f,\"id\":\"%llx\",\"args\":{\"value\":%llu}}",
+                separator, event->name, buffer->thread_id, ts,
+                (unsigned long long)(uintptr_t)event->id,
+                (unsigned long long)event->value);
+      }
+      separator = ",";
+    }
+  }
+  fprintf(out, "\n],\"displayTimeUnit\":\"ns\"}\n");
+
+  if (ferror(out)) {
+    return TRACE_IO_FAILED;
+  }
+  return TRACE_SUCCESS;
+}
+
+static void trace_record(TraceEvent event) {
+  TraceBuffer *buffer = thread_buffer;
+  if (buffer == NULL) {
+    buffer = trace_register_thread();
+    if (buffer == NULL) {
+      return;
+    }
+  }
+  uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_RELAXED);
+  buffer->events[head % TRACE_BUFFER_EVENTS] = event;
+  __atomic_store_n(&buffer->head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Allocates the ring buffer of the calling thread and pushes it onto the list
+// of buffers.
+static TraceBuffer *trace_register_thread(void) {
+  TraceBuffer *buffer = calloc(1, sizeof(TraceBuffer));
+  if (buffer == NULL) {
+    return NULL;
+  }
+  buffer->thread_id = __atomic_add_fetch(&next_thread_id, 1, __ATOMIC_RELAXED);
+
+  buffer->next = __atomic_load_n(&buffers, __ATOMIC_RELAXED);
+  while (!__atomic_compare_exchange_n(&buffers, &buffer->next, buffer, 1,
+                                      __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+  }
+  thread_buffer = buffer;
+  return buffer;
+}
+
+// Returns the earliest timestamp of all recorded events, exported timestamps
+// are relative to it. Zones are recorded when they end, so the first recorded
+// event is not necessarily the earliest one.
+static uint64_t trace_first_timestamp(void) {
+  uint64_t first_timestamp = UINT64_MAX;
+  for (TraceBuffer *buffer = __atomic_load_n(&buffers, __ATOMIC_ACQUIRE);
+       buffer != NULL; buffer = buffer->next) {
+    uint64_t head = __atomic_load_n(&buffer->head, __ATOMIC_ACQUIRE);
+    uint64_t first =
+        head > TRACE_BUFFER_EVENTS ? head - TRACE_BUFFER_EVENTS : 0;
+    for (uint64_t o = first; o < head; ++o) {
+      TraceEvent *event = &buffer->events[o % TRACE_BUFFER_EVENTS];
+      if (event->timestamp < first_timestamp) {
+        first_timestamp = event->timestamp;
+      }
+    }
+  }
+  return first_timestamp == UINT64_MAX ? 0 : first_timestamp;
+}
+
+uint64_t trace_clock_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Measures the length of a tick against the monotonic clock. Only done on
+// export to keep the calibration off the hot path.
+static double ns_per_tick(void) {
+#ifdef TRACE_CYCLE_COUNTER
+  struct timespec pause = {.tv_sec = 0, .tv_nsec = 10 * 1000 * 1000};
+  uint64_t ticks_begin = trace_now();
+  uint64_t ns_begin = trace_clock_ns();
+  nanosleep(&pause, NULL);
+  uint64_t ticks_end = trace_now();
+  uint64_t ns_end = trace_clock_ns();
+  return (double)(ns_end - ns_begin) / (double)(ticks_end - ticks_begin);
+#else
+  return 1.0;
+#endif
+}
+
+#else
+
+TraceError trace_export_chrome(FILE *out) {
+  fprintf(out, "{\"traceEvents\":[]}\n");
+  if (ferror(out)) {
+    return TRACE_IO_FAILED;
+  }
+  return TRACE_SUCCESS;
+}
+
+#endif // TRACE_ENABLED
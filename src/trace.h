@@ -0,0 +1,83 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+// Hot-path tracing with scoped zones and counters. Every thread records into
+// its own ring buffer, so recording never takes a lock. When the buffer is full
+// the oldest events are overwritten.
+//
+// Everything is compiled out unless `TRACE_ENABLED` is defined, e.g. by
+// building with `make TRACE=1`.
+
+typedef enum {
+  TRACE_SUCCESS,
+  TRACE_IO_FAILED,
+} TraceError;
+
+// Writes all recorded events as Chrome trace-event JSON, loadable in
+// `chrome://tracing` or Perfetto. Should be called once the traced threads
+// stopped recording, otherwise events being overwritten may be torn.
+TraceError trace_export_chrome(FILE *out);
+
+#ifdef TRACE_ENABLED
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define TRACE_CYCLE_COUNTER
+#elif defined(__aarch64__)
+#define TRACE_CYCLE_COUNTER
+#endif
+
+// Number of events each thread is able to hold before overwriting.
+#ifndef TRACE_BUFFER_EVENTS
+#define TRACE_BUFFER_EVENTS (1 << 16)
+#endif
+
+typedef struct TraceZone {
+  // Has to be a string literal, only the pointer is recorded.
+  const char *name;
+  uint64_t begin;
+} TraceZone;
+
+uint64_t trace_clock_ns(void);
+void trace_zone_end(TraceZone *zone);
+void trace_counter(const char *name, const void *id, uint64_t value);
+
+// Returns the current timestamp in ticks. Reads the cycle counter where there
+// is one and falls back to nanoseconds of the monotonic clock otherwise.
+static inline uint64_t trace_now(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#elif defined(__aarch64__)
+  uint64_t ticks;
+  __asm__ volatile("mrs %0, cntvct_el0" : "=r"(ticks));
+  return ticks;
+#else
+  return trace_clock_ns();
+#endif
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+
+// Records the time from here until the end of the enclosing scope.
+#define TRACE_ZONE(zone_name)                                                  \
+  TraceZone TRACE_CONCAT(trace_zone_, __LINE__)                                \
+      __attribute__((cleanup(trace_zone_end))) = {.name = zone_name,           \
+                                                  .begin = trace_now()}
+
+// Records the current value of the named counter. Every distinct `id`, e.g. the
+// address of the instance being measured, gets a track of its own.
+#define TRACE_COUNTER(name, id, value)                                         \
+  trace_counter(name, id, (uint64_t)(value))
+
+#else
+
+#define TRACE_ZONE(zone_name) ((void)0)
+#define TRACE_COUNTER(name, id, value) ((void)0)
+
+#endif // TRACE_ENABLED
+
+#endif // TRACE_H
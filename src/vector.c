@@ -1,5 +1,7 @@
 #include "vector.h"
 #include "allocator.h"
+#include "trace.h"
+#include <limits.h>
 
 static HeapAllocator default_allocator = {};
 static Allocator allocator = {
@@ -29,36 +31,53 @@ Vector new_vector(VectorParams params) {
     exit(420);
   unsigned int stride = params.stride;
 
-  Vector vec =
-      allocator.alloc(&allocator, stride * capacity + sizeof(VectorParams));
-  ((unsigned int *)vec)[0] = length;
-  ((unsigned int *)vec)[1] = capacity;
-  ((unsigned int *)vec)[2] = stride;
+  Allocator *alloc = params.allocator;
+  if (alloc == NULL)
+    alloc = &allocator;
 
-  return (Vector) & (((VectorParams *)vec)[1]);
+  VectorParams *vec = alloc->alloc(
+      alloc, (size_t)stride * capacity + sizeof(VectorParams));
+  if (vec == NULL)
+    return NULL;
+  vec->length = length;
+  vec->capacity = capacity;
+  vec->stride = stride;
+  vec->allocator = alloc;
+
+  return (Vector) & (vec[1]);
 }
 
 Vector v_increase_size(Vector vec) {
+  TRACE_ZONE("v_increase_size");
   unsigned int capacity = v_capacity(vec);
   unsigned int stride = v_stride(vec);
-  v_set_capacity(vec, capacity * 2);
-  Vector new_vec =
-      allocator.realloc(&allocator, v_full_vector(vec),
-                        2 * capacity * stride + v_base_offset(vec));
+  if (capacity > UINT_MAX / 2) {
+    // Doubling would overflow the stored capacity.
+    return NULL;
+  }
+  Allocator *alloc = v_params(vec)->allocator;
+  VectorParams *new_vec =
+      alloc->realloc(alloc, v_full_vector(vec),
+                     2 * (size_t)capacity * stride + v_base_offset(vec));
   if (new_vec == NULL) {
     return NULL;
   }
-  return (Vector) & (((VectorParams *)new_vec)[1]);
+  new_vec->capacity = capacity * 2;
+  return (Vector) & (new_vec[1]);
 }
 
 Vector v_append(Vector vec, void *value) {
+  TRACE_ZONE("v_append");
   VectorParams params = *v_params(vec);
 
   if (params.length == params.capacity) {
     vec = v_increase_size(vec);
+    if (vec == NULL) {
+      return NULL;
+    }
   }
 
-  memcpy(vec + params.stride * params.length, value, params.stride);
+  memcpy(vec + (size_t)params.stride * params.length, value, params.stride);
   v_inc_length(vec);
   return vec;
 }
@@ -70,10 +89,11 @@ void v_drop(Vector vec, void *result) {
     return;
   }
   v_dec_length(vec);
-  memcpy(result, vec + params.stride * params.length, params.stride);
+  memcpy(result, vec + (size_t)params.stride * params.length, params.stride);
 }
 
 Vector v_map(Vector vec, MapFunction fun, unsigned int stride) {
+  TRACE_ZONE("v_map");
   VectorParams params = {
       .length = 0,
       .capacity = v_capacity(vec),
@@ -82,7 +102,7 @@ Vector v_map(Vector vec, MapFunction fun, unsigned int stride) {
   Vector mapped_vec = new_vector(params);
   unsigned int length = v_length(vec);
   char buf[stride];
-  for (int o = 0; o < length; ++o) {
+  for (unsigned int o = 0; o < length; ++o) {
     fun(v_at(vec, o), buf);
     mapped_vec = v_append(mapped_vec, buf);
   }
@@ -91,14 +111,15 @@ Vector v_map(Vector vec, MapFunction fun, unsigned int stride) {
 
 Vector v_map_m(Vector vec, MapFunction fun, unsigned int new_stride) {
   unsigned int length = v_length(vec);
-  unsigned int old_byte_length = length * v_stride(vec);
-  unsigned int new_byte_length = length * new_stride;
+  size_t old_byte_length = (size_t)length * v_stride(vec);
+  size_t new_byte_length = (size_t)length * new_stride;
   if (new_byte_length > old_byte_length) {
     // Make sure we always have enough memory available to fit all elements
     // when a vector is reaching full capacity.
-    VectorParams *tmp = (VectorParams *)allocator.realloc(
-        &allocator, v_full_vector(vec),
-        v_capacity(vec) * new_stride + v_base_offset(vec));
+    Allocator *alloc = v_params(vec)->allocator;
+    VectorParams *tmp = (VectorParams *)alloc->realloc(
+        alloc, v_full_vector(vec),
+        (size_t)v_capacity(vec) * new_stride + v_base_offset(vec));
     if (tmp == NULL) {
       return NULL;
     }
@@ -116,8 +137,8 @@ Vector v_map_m(Vector vec, MapFunction fun, unsigned int new_stride) {
 static Vector v_map_from_back(Vector vec, MapFunction fun,
                               unsigned int stride) {
   unsigned int length = v_length(vec);
-  for (int o = (length - 1); o >= 0; --o) {
-    fun(v_at(vec, o), vec + o * stride);
+  for (unsigned int o = length; o-- > 0;) {
+    fun(v_at(vec, o), vec + (size_t)o * stride);
   }
   return vec;
 }
@@ -125,8 +146,8 @@ static Vector v_map_from_back(Vector vec, MapFunction fun,
 static Vector v_map_from_front(Vector vec, MapFunction fun,
                                unsigned int stride) {
   unsigned int length = v_length(vec);
-  for (int o = 0; o < length; ++o) {
-    fun(v_at(vec, o), vec + o * stride);
+  for (unsigned int o = 0; o < length; ++o) {
+    fun(v_at(vec, o), vec + (size_t)o * stride);
   }
   return vec;
 }
@@ -137,11 +158,11 @@ void *v_at(Vector vec, unsigned int offset) {
     exit(-1);
   }
 
-  return vec + v_stride(vec) * offset;
+  return vec + (size_t)v_stride(vec) * offset;
 }
 
 void v_insert_at(Vector vec, unsigned int offset, void *value) {
-  for (int k = v_length(vec); k > offset; --k) {
+  for (unsigned int k = v_length(vec); k > offset; --k) {
     v_set_at(vec, k, v_at(vec, k - 1));
   }
   v_set_at(vec, offset, value);
@@ -150,10 +171,13 @@ void v_insert_at(Vector vec, unsigned int offset, void *value) {
 
 void v_set_at(Vector vec, unsigned int offset, void *value) {
   unsigned int stride = v_stride(vec);
-  memcpy(vec + stride * offset, value, stride);
+  memcpy(vec + (size_t)stride * offset, value, stride);
 }
 
-void v_free(Vector vec) { allocator.free(&allocator, v_full_vector(vec)); }
+void v_free(Vector vec) {
+  Allocator *alloc = v_params(vec)->allocator;
+  alloc->free(alloc, v_full_vector(vec));
+}
 unsigned int v_base_offset(Vector vec) { return sizeof(VectorParams); }
 VectorParams *v_params(Vector vec) { return ((VectorParams *)vec) - 1; }
 unsigned int v_length(Vector vec) { return v_params(vec)->length; }
@@ -1,6 +1,7 @@
 #ifndef VECTOR_H
 #define VECTOR_H
 
+#include "allocator.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -11,9 +12,16 @@ typedef struct VectorParams {
   unsigned int length;
   unsigned int capacity;
   unsigned int stride;
+  // Allocator backing this vector, the shared heap allocator if NULL. Give
+  // every vector its own `VirtualAllocator` to grow it in place without
+  // copying, which keeps pointers from `v_at` valid. Growth fails once the
+  // reservation is exhausted.
+  Allocator *allocator;
 } VectorParams;
 
 Vector new_vector(VectorParams params);
+// Appends a copy of `value`, growing the vector if it is full. Returns NULL if
+// the vector could not grow, `vec` is left untouched in that case.
 Vector v_append(Vector vec, void *value);
 unsigned int v_base_offset(Vector vec);
 unsigned int v_length(Vector vec);
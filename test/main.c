@@ -1,7 +1,9 @@
 #include "allocator.h"
 #include "graph.h"
+#include "trace.h"
 #include "vector.h"
 #include <stdio.h>
+#include <string.h>
 
 typedef int (*TEST_CASE)(void);
 typedef enum {
@@ -178,10 +180,265 @@ int vector_test() {
   return SUCCESS;
 }
 
+int virtual_vector_test() {
+  // Reserve far more than needed, pages are only committed on demand.
+  VirtualAllocator strategy =
+      new_virtual_allocator(64 * 1024 * 1024, VIRTUAL_HUGE_PAGES);
+  ASSERT((strategy.base != NULL), 1,
+         "virtual allocator should reserve its range actual: %d expected: %d");
+
+  Allocator allocator = virtual_allocator_interface(&strategy);
+
+  VectorParams params = {
+      .stride = sizeof(unsigned int),
+      .capacity = 16,
+      .allocator = &allocator,
+  };
+  unsigned int *my_vec = new_vector(params);
+  unsigned int first = 0;
+  my_vec = v_append(my_vec, &first);
+  unsigned int *first_elem = v_at(my_vec, 0);
+
+  for (unsigned int o = 1; o < 100000; ++o) {
+    my_vec = v_append(my_vec, &o);
+  }
+  ASSERT((v_at(my_vec, 0) == first_elem), 1,
+         "growing a virtual vector should keep its address actual: %d "
+         "expected: %d");
+  ASSERT(v_length(my_vec), 100000,
+         "vector should report correct length actual: %d expected %d");
+  for (unsigned int o = 0; o < v_length(my_vec); ++o) {
+    ASSERT(my_vec[o], o,
+           "vector entries should match expected actual: %d expected: %d");
+  }
+
+  allocator.free_all(&allocator);
+  ASSERT(strategy.committed, 0,
+         "free_all should decommit all pages actual: %zu expected: %d");
+  virtual_release(&strategy);
+  return SUCCESS;
+}
+
+#define LARGE_STRIDE (1024 * 1024)
+
+typedef struct LargeElement {
+  char bytes[LARGE_STRIDE];
+} LargeElement;
+
+static LargeElement large_element;
+
+int virtual_vector_large_test() {
+  // Starts with 4 GiB of elements and grows to 8 GiB, only the pages actually
+  // touched get committed.
+  unsigned int capacity = 4096;
+  VirtualAllocator strategy =
+      new_virtual_allocator(2 * (size_t)capacity * LARGE_STRIDE + 4096, 0);
+  ASSERT((strategy.base != NULL), 1,
+         "virtual allocator should reserve its range actual: %d expected: %d");
+  Allocator allocator = virtual_allocator_interface(&strategy);
+
+  VectorParams params = {
+      .stride = LARGE_STRIDE,
+      .capacity = capacity,
+      .allocator = &allocator,
+  };
+  LargeElement *large_vec = new_vector(params);
+  ASSERT((large_vec != NULL), 1,
+         "large vector should be created actual: %d expected: %d");
+
+  // Pretend the vector is full, so the next append grows it across 4 GiB.
+  LargeElement *before_growth = large_vec;
+  v_set_length(large_vec, capacity);
+  memset(large_element.bytes, 0x5a, LARGE_STRIDE);
+  large_vec = v_append(large_vec, &large_element);
+  ASSERT((large_vec == before_growth), 1,
+         "growing past 4 GiB should keep the address actual: %d expected: %d");
+  ASSERT(v_capacity(large_vec), 2 * capacity,
+         "growing past 4 GiB should double the capacity actual: %d "
+         "expected: %d");
+  ASSERT(v_length(large_vec), capacity + 1,
+         "header should survive writes past 4 GiB actual: %d expected: %d");
+  ASSERT(v_stride(large_vec), LARGE_STRIDE,
+         "header should survive writes past 4 GiB actual: %d expected: %d");
+
+  LargeElement *appended = v_at(large_vec, capacity);
+  ASSERT(((char *)appended - (char *)large_vec), (long)capacity * LARGE_STRIDE,
+         "element past 4 GiB should be at its offset actual: %ld "
+         "expected: %ld");
+  ASSERT(appended->bytes[LARGE_STRIDE - 1], 0x5a,
+         "appended element should match actual: %d expected: %d");
+
+  large_element.bytes[0] = 0x3c;
+  v_set_at(large_vec, capacity, &large_element);
+  ASSERT(appended->bytes[0], 0x3c,
+         "set element should match actual: %d expected: %d");
+  ASSERT(v_length(large_vec), capacity + 1,
+         "header should survive writes past 4 GiB actual: %d expected: %d");
+  virtual_release(&strategy);
+
+  // Byte sized elements reach a capacity which cannot be doubled anymore.
+  unsigned int max_capacity = 1u << 31;
+  strategy = new_virtual_allocator((size_t)max_capacity + 4096, 0);
+  allocator = virtual_allocator_interface(&strategy);
+  VectorParams byte_params = {
+      .stride = sizeof(char),
+      .capacity = max_capacity,
+      .allocator = &allocator,
+  };
+  char *byte_vec = new_vector(byte_params);
+  v_set_length(byte_vec, max_capacity);
+  char byte = 1;
+  ASSERT((v_append(byte_vec, &byte) == NULL), 1,
+         "growing past the maximum capacity should fail actual: %d "
+         "expected: %d");
+  ASSERT(v_capacity(byte_vec), max_capacity,
+         "failed growth should keep the capacity actual: %u expected: %u");
+
+  virtual_release(&strategy);
+  return SUCCESS;
+}
+
+int virtual_vector_exhausted_test() {
+  VirtualAllocator strategy = new_virtual_allocator(64 * 1024, 0);
+  Allocator allocator = virtual_allocator_interface(&strategy);
+  VectorParams params = {
+      .stride = sizeof(unsigned int),
+      .capacity = 16,
+      .allocator = &allocator,
+  };
+  unsigned int *my_vec = new_vector(params);
+
+  // Fill the reservation until the vector is unable to grow any further.
+  unsigned int o = 0;
+  for (unsigned int *grown = my_vec; grown != NULL; ++o) {
+    my_vec = grown;
+    grown = v_append(my_vec, &o);
+  }
+  unsigned int length = v_length(my_vec);
+  ASSERT(length, o - 1,
+         "failed append should leave the vector untouched actual: %d "
+         "expected: %d");
+  for (unsigned int k = 0; k < length; ++k) {
+    ASSERT(my_vec[k], k,
+           "vector entries should match expected actual: %d expected: %d");
+  }
+
+  // A second vector in the same reservation blocks growth of the first one.
+  allocator.free_all(&allocator);
+  unsigned int *first_vec = new_vector(params);
+  unsigned int *second_vec = new_vector(params);
+  for (o = 0; o < v_capacity(first_vec); ++o) {
+    first_vec = v_append(first_vec, &o);
+  }
+  ASSERT((v_append(first_vec, &o) == NULL), 1,
+         "growing an older virtual allocation should fail actual: %d "
+         "expected: %d");
+
+  unsigned int second_capacity = v_capacity(second_vec);
+  for (unsigned int k = 0; k < second_capacity; ++k) {
+    second_vec = v_append(second_vec, &k);
+  }
+  unsigned int *second_before_growth = second_vec;
+  second_vec = v_append(second_vec, &o);
+  ASSERT((second_vec != NULL), 1,
+         "most recent virtual allocation should grow actual: %d expected: %d");
+  ASSERT((second_vec == second_before_growth), 1,
+         "most recent virtual allocation should grow in place actual: %d "
+         "expected: %d");
+  ASSERT(v_capacity(second_vec), 2 * second_capacity,
+         "growing should double the capacity actual: %d expected: %d");
+  ASSERT(first_vec[v_length(first_vec) - 1], o - 1,
+         "failed growth should keep existing entries actual: %d expected: %d");
+
+  virtual_release(&strategy);
+  return SUCCESS;
+}
+
+int trace_test() {
+  unsigned int *my_vec = VEC(unsigned int, 1);
+  for (unsigned int o = 0; o < 4; ++o) {
+    my_vec = v_append(my_vec, &o);
+  }
+  v_free(my_vec);
+
+  // Two allocators feeding the same counter have to end up on separate tracks.
+  char arena_a[64];
+  char arena_b[64];
+  StackAllocator strategy_a = new_stack_allocator(arena_a, sizeof(arena_a));
+  StackAllocator strategy_b = new_stack_allocator(arena_b, sizeof(arena_b));
+  struct Allocator allocator_a = {.strategy = &strategy_a,
+                                  .alloc = stack_alloc};
+  struct Allocator allocator_b = {.strategy = &strategy_b,
+                                  .alloc = stack_alloc};
+  allocator_a.alloc(&allocator_a, 16);
+  allocator_b.alloc(&allocator_b, 32);
+  char track_a[64] = {0};
+  char track_b[64] = {0};
+  snprintf(track_a, sizeof(track_a), "\"id\":\"%llx\",\"args\":{\"value\":16}",
+           (unsigned long long)(uintptr_t)&strategy_a);
+  snprintf(track_b, sizeof(track_b), "\"id\":\"%llx\",\"args\":{\"value\":32}",
+           (unsigned long long)(uintptr_t)&strategy_b);
+
+  FILE *out = tmpfile();
+  ASSERT((out != NULL), 1,
+         "temporary trace file should open actual: %d expected: %d");
+  ASSERT(trace_export_chrome(out), TRACE_SUCCESS,
+         "trace export should succeed actual: %d expected: %d");
+  // Every event is written on its own line.
+  char line[256] = {0};
+  int found_append = 0;
+  int found_increase = 0;
+  int found_counter = 0;
+  int found_negative = 0;
+  int found_track_a = 0;
+  int found_track_b = 0;
+  rewind(out);
+  ASSERT((fgets(line, sizeof(line), out) != NULL), 1,
+         "trace should not be empty actual: %d expected: %d");
+  ASSERT((strncmp(line, "{\"traceEvents\":[", 16) == 0), 1,
+         "trace should be a chrome trace-event object actual: %d expected: %d");
+  while (fgets(line, sizeof(line), out) != NULL) {
+    found_append |=
+        strstr(line, "\"name\":\"v_append\",\"ph\":\"X\"") != NULL;
+    found_increase |= strstr(line, "\"name\":\"v_increase_size\"") != NULL;
+    found_counter |= strstr(line, "\"ph\":\"C\"") != NULL;
+    found_negative |= strstr(line, "\"ts\":-") != NULL;
+    if (strstr(line, "\"name\":\"stack_alloc.bytes\"") != NULL) {
+      found_track_a |= strstr(line, track_a) != NULL;
+      found_track_b |= strstr(line, track_b) != NULL;
+    }
+  }
+  fclose(out);
+#ifdef TRACE_ENABLED
+  ASSERT(found_append, 1,
+         "trace should contain v_append zones actual: %d expected: %d");
+  ASSERT(found_increase, 1,
+         "trace should contain v_increase_size zones actual: %d expected: %d");
+  ASSERT(found_counter, 1,
+         "trace should contain counters actual: %d expected: %d");
+  ASSERT(found_negative, 0,
+         "trace should not contain negative timestamps actual: %d expected: "
+         "%d");
+  ASSERT(found_track_a, 1,
+         "first allocator should have its own counter track actual: %d "
+         "expected: %d");
+  ASSERT(found_track_b, 1,
+         "second allocator should have its own counter track actual: %d "
+         "expected: %d");
+#endif
+  return SUCCESS;
+}
+
 int main() {
   TestCase test_cases[] = {
       {.test_fun = vector_test, .name = "VECTOR_TEST"},
       {.test_fun = graph_test, .name = "GRAPH_TEST"},
+      {.test_fun = virtual_vector_test, .name = "VIRTUAL_VECTOR_TEST"},
+      {.test_fun = virtual_vector_large_test,
+       .name = "VIRTUAL_VECTOR_LARGE_TEST"},
+      {.test_fun = virtual_vector_exhausted_test,
+       .name = "VIRTUAL_VECTOR_EXHAUSTED_TEST"},
+      {.test_fun = trace_test, .name = "TRACE_TEST"},
       {0}, // Sentinel value, always last element.
   };
   TestCase test_case = test_cases[0];